@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""
+Turns the output of Tracer::dump() (mp4 - mp6, trace.H) into histograms.
+
+bochs writes the serial port to serial.txt (see bochsrc.bxrc), so after a
+run with _DUMP_TRACE_ defined:
+
+    python3 ../tools/trace_report.py serial.txt --kernel kernel.bin
+
+Each dump (one per benchmark) is reported on its own:
+  - event counts, and how much of the run the ring still covers
+  - time spent in each interrupt handler (IRQ enter to exit)
+  - disk request latency (submit to complete), reads and writes apart
+  - length of the slices threads ran between context switches
+  - sizes of frame allocations, and page faults per 4 MB region
+  - the flat profile of the timer samples. With --kernel the EIPs are
+    mapped to functions using nm (and c++filt, if there is one).
+
+All times are in CPU cycles, the histograms have power of 2 buckets.
+"""
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+EVENTS = ["CONTEXT_SWITCH", "PAGE_FAULT", "FRAME_ALLOC", "FRAME_FREE",
+          "DISK_SUBMIT", "DISK_COMPLETE", "IRQ_ENTER", "IRQ_EXIT"]
+(CONTEXT_SWITCH, PAGE_FAULT, FRAME_ALLOC, FRAME_FREE,
+ DISK_SUBMIT, DISK_COMPLETE, IRQ_ENTER, IRQ_EXIT) = range(len(EVENTS))
+
+IRQ_NAMES = {0: "timer", 1: "keyboard", 14: "disk"}
+BAR_WIDTH = 40
+
+
+class Dump:
+    def __init__(self, name, n_events, n_samples):
+        self.name = name
+        self.n_events = n_events
+        self.n_samples = n_samples
+        self.events = []    # (tsc, event, a, b), oldest first
+        self.counts = {}
+        self.samples = []
+
+
+def parse(lines):
+    dumps = []
+    dump = None
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        try:
+            if fields[0] == "TRACE" and len(fields) == 4:
+                dump = Dump(fields[1], int(fields[2], 16), int(fields[3], 16))
+            elif dump is None:
+                continue    # whatever else went over the line
+            elif fields[0] == "E" and len(fields) == 5:
+                dump.events.append(tuple(int(f, 16) for f in fields[1:]))
+            elif fields[0] == "C" and len(fields) == 3:
+                dump.counts[int(fields[1], 16)] = int(fields[2], 16)
+            elif fields[0] == "S" and len(fields) == 2:
+                dump.samples.append(int(fields[1], 16))
+            elif fields[0] == "END":
+                dumps.append(dump)
+                dump = None
+        except ValueError:
+            pass            # a line cut short, skip it
+    return dumps
+
+
+def histogram(title, values, unit="cycles"):
+    print("  %s (%d, %s)" % (title, len(values), unit))
+    if not values:
+        print("    none")
+        return
+    buckets = collections.Counter(v.bit_length() for v in values)
+    most = max(buckets.values())
+    for bucket in range(min(buckets), max(buckets) + 1):
+        low = 0 if bucket == 0 else 1 << (bucket - 1)
+        n = buckets.get(bucket, 0)
+        print("    %10s - %-10s %-*s %d" % (human(low), human((1 << bucket) - 1 if bucket else 0),
+                                           BAR_WIDTH, "#" * ((n * BAR_WIDTH + most - 1) // most), n))
+    values = sorted(values)
+    print("    min %s  median %s  p99 %s  max %s" % (human(values[0]), human(values[len(values) // 2]),
+                                                     human(values[(len(values) * 99) // 100]), human(values[-1])))
+
+
+def human(n):
+    for unit, size in (("G", 1 << 30), ("M", 1 << 20), ("K", 1 << 10)):
+        if n >= size:
+            return "%d%s" % (n // size, unit)
+    return str(n)
+
+
+def irq_times(events):
+    """Cycles from IRQ enter to exit, per irq. Handlers can nest.
+
+    A handler that switches threads before its exit would be charged the run
+    time of the other threads, so a context switch drops all open enters.
+    """
+    times = collections.defaultdict(list)
+    stack = []
+    for tsc, event, a, b in events:
+        if event == CONTEXT_SWITCH:
+            stack = []
+        elif event == IRQ_ENTER:
+            stack.append((a, tsc))
+        elif event == IRQ_EXIT and stack:
+            # an exit without its enter (it was overwritten) closes nothing
+            while stack and stack[-1][0] != a:
+                stack.pop()
+            if stack:
+                times[a].append(tsc - stack.pop()[1])
+    return times
+
+
+def disk_latencies(events):
+    """Cycles from submit to complete, matched in order per operation and block."""
+    latencies = collections.defaultdict(list)
+    pending = collections.defaultdict(collections.deque)
+    for tsc, event, a, b in events:
+        if event == DISK_SUBMIT:
+            pending[(a, b)].append(tsc)
+        elif event == DISK_COMPLETE and pending[(a, b)]:
+            latencies[a].append(tsc - pending[(a, b)].popleft())
+    return latencies
+
+
+def run_slices(events):
+    """Cycles each thread ran between being switched to and the next switch."""
+    slices = collections.defaultdict(list)
+    running = None
+    for tsc, event, a, b in events:
+        if event == CONTEXT_SWITCH:
+            if running is not None:
+                slices[running[0]].append(tsc - running[1])
+            running = (a, tsc)
+    return slices
+
+
+class Symbols:
+    def __init__(self, kernel):
+        self.addresses = []
+        self.names = []
+        if kernel is None:
+            return
+        try:
+            out = subprocess.run(["nm", "-n", "--defined-only", kernel], capture_output=True,
+                                 text=True, check=True).stdout
+        except (OSError, subprocess.CalledProcessError) as error:
+            print("cannot read the symbols of %s: %s" % (kernel, error), file=sys.stderr)
+            return
+        symbols = []
+        for line in out.splitlines():
+            fields = line.split()
+            if len(fields) == 3 and fields[1] in "tTwW":
+                symbols.append((int(fields[0], 16), fields[2]))
+        names = [name for _, name in symbols]
+        try:
+            # the kernel is built with -fleading-underscore, so strip one
+            out = subprocess.run(["c++filt", "-_"], input="\n".join(names), capture_output=True,
+                                 text=True, check=True).stdout.splitlines()
+            if len(out) == len(names):
+                names = out
+        except (OSError, subprocess.CalledProcessError):
+            pass
+        # plain C names keep the extra underscore
+        names = [name[1:] if name.startswith("_") else name for name in names]
+        self.addresses = [address for address, _ in symbols]
+        self.names = names
+
+    def lookup(self, address):
+        i = bisect.bisect_right(self.addresses, address) - 1
+        if i < 0:
+            return "0x%08x" % address
+        return self.names[i]
+
+
+def profile(samples, symbols, top):
+    print("  profile (%d timer samples)" % len(samples))
+    if not samples:
+        print("    none")
+        return
+    counts = collections.Counter(symbols.lookup(eip) for eip in samples)
+    most = counts.most_common(1)[0][1]
+    for name, n in counts.most_common(top):
+        print("    %5.1f%% %-*s %s" % (100.0 * n / len(samples), BAR_WIDTH // 2,
+                                      "#" * ((n * BAR_WIDTH // 2 + most - 1) // most), name))
+
+
+def report(dump, symbols, top):
+    print("=== %s" % dump.name)
+    events = sorted(dump.events)    # nested writers may have stored out of order
+    print("  %d events recorded, %d still in the ring" % (dump.n_events, len(events)), end="")
+    if len(events) > 1:
+        print(", covering %s cycles" % human(events[-1][0] - events[0][0]))
+    else:
+        print()
+    for event, name in enumerate(EVENTS):
+        if dump.counts.get(event):
+            print("    %-16s %d" % (name, dump.counts[event]))
+
+    for irq, times in sorted(irq_times(events).items()):
+        histogram("IRQ %d (%s) handler time" % (irq, IRQ_NAMES.get(irq, "?")), times)
+    for operation, latencies in sorted(disk_latencies(events).items()):
+        histogram("disk %s latency" % ("write" if operation else "read"), latencies)
+
+    slices = run_slices(events)
+    if slices:
+        histogram("thread run slices", [s for thread in slices.values() for s in thread])
+        for thread, times in sorted(slices.items()):
+            print("    thread %d: %d slices, %s cycles" % (thread, len(times), human(sum(times))))
+
+    allocations = [a for tsc, event, a, b in events if event == FRAME_ALLOC]
+    if allocations:
+        histogram("frame allocation sizes", allocations, unit="frames")
+    faults = collections.Counter(b >> 22 for tsc, event, a, b in events if event == PAGE_FAULT)
+    if faults:
+        print("  page faults per 4 MB region")
+        for region, n in sorted(faults.items()):
+            print("    0x%08x %d" % (region << 22, n))
+
+    profile(dump.samples, symbols, top)
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("serial_log", help="the serial port output, e.g. serial.txt")
+    parser.add_argument("--kernel", help="kernel.bin, to map the profiler samples to functions")
+    parser.add_argument("--dump", help="only report the dump with this name")
+    parser.add_argument("--top", type=int, default=20, help="functions in the profile (default 20)")
+    args = parser.parse_args()
+
+    with open(args.serial_log, errors="replace") as log:
+        dumps = parse(log)
+    if args.dump is not None:
+        dumps = [dump for dump in dumps if dump.name == args.dump]
+    if not dumps:
+        sys.exit("no trace dump found in %s" % args.serial_log)
+
+    symbols = Symbols(args.kernel)
+    for dump in dumps:
+        report(dump, symbols, args.top)
+
+
+if __name__ == "__main__":
+    main()